@@ -0,0 +1,346 @@
+//---------------------------------------------------------------------------
+// #######
+// # AnD #
+// #######
+//---------------------------------------------------------------------------
+// This file contains small helpers for placing memory on NUMA nodes. Memory
+// is mapped directly and bound with the mbind syscall before it is touched
+// for the first time, so no libnuma is required. On single-node machines and
+// on platforms other than Linux all policies degrade to plain allocations.
+//---------------------------------------------------------------------------
+#ifndef NUMA_H_
+#define NUMA_H_
+//---------------------------------------------------------------------------
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+#if defined(__linux__)
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+//---------------------------------------------------------------------------
+namespace data_structures::numa {
+//---------------------------------------------------------------------------
+/// The placement policy of a memory region.
+enum class Policy : uint8_t {
+    /// Leave placement to the operating system (first touch).
+    NONE,
+    /// Interleave the pages round-robin over all nodes.
+    INTERLEAVE,
+    /// Split the region into contiguous partitions, one per node by default.
+    PARTITION
+};
+//---------------------------------------------------------------------------
+/// A contiguous part of a memory region residing on a single node.
+struct Region {
+    /// The first byte of the region
+    const void* begin;
+    /// The size of the region in bytes
+    size_t size;
+    /// The node the region lives on, -1 if unknown or not yet touched
+    int32_t node;
+};
+//---------------------------------------------------------------------------
+/// Parse a kernel list such as "0-3,8-11".
+inline std::vector<uint32_t> parse_list(const std::string& list) {
+    std::vector<uint32_t> result;
+    size_t pos = 0;
+    while(pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if(end == std::string::npos)
+            end = list.size();
+        auto range = list.substr(pos, end - pos);
+        if(!range.empty() && range.find_first_not_of("0123456789-\n") == std::string::npos) {
+            auto dash = range.find('-');
+            uint32_t first = std::stoul(range.substr(0, dash));
+            uint32_t last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+            for(uint32_t i = first; i <= last; ++i)
+                result.push_back(i);
+        }
+        pos = end + 1;
+    }
+    return result;
+}
+//---------------------------------------------------------------------------
+/// Get the ids of all online nodes.
+inline const std::vector<uint32_t>& nodes() {
+    static const std::vector<uint32_t> online = [] {
+        std::vector<uint32_t> result;
+#if defined(__linux__)
+        std::ifstream file("/sys/devices/system/node/online");
+        std::string list;
+        if(std::getline(file, list))
+            result = parse_list(list);
+#endif
+        if(result.empty())
+            result.push_back(0);
+        return result;
+    }();
+    return online;
+}
+//---------------------------------------------------------------------------
+/// Get the number of online nodes.
+inline uint32_t node_count() { return nodes().size(); }
+//---------------------------------------------------------------------------
+/// Get the node each cpu belongs to.
+inline const std::vector<uint32_t>& cpu_nodes() {
+    static const std::vector<uint32_t> mapping = [] {
+        std::vector<uint32_t> result;
+#if defined(__linux__)
+        for(auto node : nodes()) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+            if(!std::getline(file, list))
+                continue;
+            for(auto cpu : parse_list(list)) {
+                if(cpu >= result.size())
+                    result.resize(cpu + 1, nodes().front());
+                result[cpu] = node;
+            }
+        }
+#endif
+        return result;
+    }();
+    return mapping;
+}
+//---------------------------------------------------------------------------
+/// Get the node the calling thread currently runs on. Uses the vDSO-backed
+/// sched_getcpu() and a cached cpu to node mapping, so no syscall is made.
+inline uint32_t current_node() {
+#if defined(__linux__)
+    if(node_count() > 1) {
+        int cpu = sched_getcpu();
+        if(cpu >= 0 && static_cast<size_t>(cpu) < cpu_nodes().size())
+            return cpu_nodes()[cpu];
+    }
+#endif
+    return nodes().front();
+}
+//---------------------------------------------------------------------------
+/// Restrict the calling thread to the cpus of the given node. This is a
+/// no-op on single-node machines.
+inline bool bind_thread_to_node(uint32_t node) {
+    if(node_count() == 1)
+        return node == nodes().front();
+#if defined(__linux__)
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string list;
+    if(!std::getline(file, list))
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(auto cpu : parse_list(list)) {
+        if(cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+//---------------------------------------------------------------------------
+/// Get the size of a memory page.
+inline size_t page_size() {
+#if defined(__linux__)
+    static const size_t size = sysconf(_SC_PAGESIZE);
+    return size;
+#else
+    return 4096;
+#endif
+}
+//---------------------------------------------------------------------------
+/// Query the nodes of the given pages. Returns false if the kernel does not
+/// support the query, e.g. without NUMA support or under seccomp profiles
+/// requiring CAP_SYS_NICE.
+inline bool query_nodes([[maybe_unused]] const std::vector<const void*>& addresses,
+                        [[maybe_unused]] std::vector<int>& status) {
+#if defined(__linux__)
+    status.assign(addresses.size(), -1);
+    return syscall(SYS_move_pages, 0, addresses.size(), addresses.data(), nullptr, status.data(), 0) >= 0;
+#else
+    return false;
+#endif
+}
+//---------------------------------------------------------------------------
+/// Check whether the nodes of pages can be queried on this host.
+inline bool placement_supported() {
+    static const bool supported = [] {
+        // The page of a local variable is always present
+        int probe = 0;
+        std::vector<int> status;
+        return query_nodes({&probe}, status) && status[0] >= 0;
+    }();
+    return supported;
+}
+//---------------------------------------------------------------------------
+/// Get the nodes the pages containing the given addresses live on with one
+/// batched query. Pages that have not been touched yet, and all pages on
+/// hosts without placement_supported(), are reported as -1.
+inline std::vector<int32_t> nodes_of(const std::vector<const void*>& addresses) {
+    std::vector<int32_t> result(addresses.size(), -1);
+    std::vector<int> status;
+    if(addresses.empty() || !query_nodes(addresses, status))
+        return result;
+    for(size_t i = 0; i < addresses.size(); ++i)
+        result[i] = status[i] >= 0 ? status[i] : -1;
+    return result;
+}
+//---------------------------------------------------------------------------
+/// Get the node the page containing the given address lives on.
+inline int32_t node_of(const void* address) { return nodes_of({address}).front(); }
+//---------------------------------------------------------------------------
+/// A page-aligned memory region placed according to a policy.
+class Buffer {
+    public:
+    /// Default constructor
+    Buffer() = default;
+    /// Constructor. Binds the pages to the nodes before they are touched. A
+    /// partitioned region is split into the given number of partitions, which
+    /// prefer the nodes round-robin. The split is kept even where binding is
+    /// a no-op.
+    Buffer(size_t size, Policy policy, uint32_t partitions = node_count()) : bytes(size), placement_policy(policy) {
+        if(size == 0)
+            return;
+        pages = (size + page_size() - 1) / page_size();
+        if(policy == Policy::PARTITION)
+            parts = std::clamp<size_t>(partitions, 1, pages);
+#if defined(__linux__)
+        void* ptr = mmap(nullptr, pages * page_size(), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(ptr == MAP_FAILED)
+            throw std::bad_alloc();
+        memory = static_cast<std::byte*>(ptr);
+#else
+        memory = static_cast<std::byte*>(::operator new(pages * page_size(), std::align_val_t(page_size())));
+#endif
+        if(node_count() == 1)
+            return;
+#if defined(__linux__)
+        if(policy == Policy::INTERLEAVE) {
+            bind(0, pages, MPOL_INTERLEAVE, nodes());
+        } else if(policy == Policy::PARTITION) {
+            for(uint32_t p = 0; p < parts; ++p)
+                bind(first_page(p), first_page(p + 1) - first_page(p), MPOL_PREFERRED, {node_of_partition(p)});
+        }
+#endif
+    }
+    /// Destructor
+    ~Buffer() { release(); }
+    /// Move constructor
+    Buffer(Buffer&& other) noexcept { *this = std::move(other); }
+    /// Move assignment
+    Buffer& operator=(Buffer&& other) noexcept {
+        if(this != &other) {
+            release();
+            memory = std::exchange(other.memory, nullptr);
+            bytes = std::exchange(other.bytes, 0);
+            pages = std::exchange(other.pages, 0);
+            parts = std::exchange(other.parts, 1);
+            placement_policy = other.placement_policy;
+        }
+        return *this;
+    }
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+
+    /// Get the start of the region.
+    std::byte* data() const { return memory; }
+    /// Get the size of the region in bytes.
+    size_t size() const { return bytes; }
+    /// Get the placement policy of the region.
+    Policy policy() const { return placement_policy; }
+    /// Get the number of partitions.
+    uint32_t partitions() const { return parts; }
+    /// Get the byte range [begin, end) of a partition.
+    std::pair<size_t, size_t> partition(uint32_t p) const {
+        return {std::min(first_page(p) * page_size(), bytes), std::min(first_page(p + 1) * page_size(), bytes)};
+    }
+    /// Get the partition containing the byte at the given offset.
+    uint32_t partition_of(size_t offset) const {
+        if(pages == 0)
+            return 0;
+        uint64_t page = offset / page_size();
+        return ((page + 1) * parts - 1) / pages;
+    }
+    /// Get the partition that is local to the given node.
+    uint32_t partition_for_node(uint32_t node) const {
+        auto it = std::find(nodes().begin(), nodes().end(), node);
+        return it == nodes().end() ? 0 : (it - nodes().begin()) % parts;
+    }
+    /// Get the node a partition is bound to.
+    uint32_t node_of_partition(uint32_t p) const { return nodes()[p % node_count()]; }
+    /// Report the nodes the pages of the region live on.
+    std::vector<Region> placement() const {
+        // Query the pages in batches to bound the size of the request
+        constexpr size_t batch = 1ull << 16;
+        std::vector<Region> regions;
+        std::vector<const void*> addresses;
+        for(size_t first = 0; first < pages; first += batch) {
+            addresses.clear();
+            for(size_t page = first; page < std::min(first + batch, pages); ++page)
+                addresses.push_back(memory + page * page_size());
+            auto page_nodes = nodes_of(addresses);
+            for(size_t i = 0; i < addresses.size(); ++i) {
+                auto size = std::min(page_size(), bytes - (first + i) * page_size());
+                if(!regions.empty() && regions.back().node == page_nodes[i])
+                    regions.back().size += size;
+                else
+                    regions.push_back({addresses[i], size, page_nodes[i]});
+            }
+        }
+        return regions;
+    }
+
+    private:
+    /// Get the first page of a partition.
+    size_t first_page(uint32_t p) const { return p * pages / parts; }
+#if defined(__linux__)
+    /// Apply a memory policy to a range of pages. Only non-strict policies
+    /// are used, so a full node falls back to the others instead of invoking
+    /// the OOM killer. Failures leave the default policy in place, placement
+    /// is only a hint.
+    void bind(size_t page, size_t count, int mode, const std::vector<uint32_t>& targets) {
+        if(count == 0)
+            return;
+        constexpr size_t bits = 8 * sizeof(unsigned long);
+        std::vector<unsigned long> mask(*std::max_element(targets.begin(), targets.end()) / bits + 1);
+        for(auto node : targets)
+            mask[node / bits] |= 1ul << (node % bits);
+        syscall(SYS_mbind, memory + page * page_size(), count * page_size(), mode, mask.data(), mask.size() * bits + 1, 0);
+    }
+#endif
+    /// Release the region.
+    void release() {
+        if(memory == nullptr)
+            return;
+#if defined(__linux__)
+        munmap(memory, pages * page_size());
+#else
+        ::operator delete(memory, std::align_val_t(page_size()));
+#endif
+        memory = nullptr;
+    }
+    /// The start of the region
+    std::byte* memory = nullptr;
+    /// The size of the region in bytes
+    size_t bytes = 0;
+    /// The number of pages backing the region
+    size_t pages = 0;
+    /// The number of partitions
+    uint32_t parts = 1;
+    /// The placement policy
+    Policy placement_policy = Policy::NONE;
+};
+//---------------------------------------------------------------------------
+}
+//---------------------------------------------------------------------------
+#endif // NUMA_H_
+//---------------------------------------------------------------------------
@@ -8,13 +8,20 @@
 // This hash table is designed for hash joins in databases. Thus, there are no
 // deletions and the hash table is built once completely and then only probed.
 // The concept described in the paper, and thus my code, makes use of this.
+// The directory and the optional entry storage can be placed on NUMA nodes,
+// see numa.h.
 //---------------------------------------------------------------------------
 #ifndef TAGGED_HASH_TABLE_H_
 #define TAGGED_HASH_TABLE_H_
 //---------------------------------------------------------------------------
+#include <algorithm>
 #include <cstdint>
 #include <vector>
 #include <atomic>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include "numa.h"
 #include "utils.h"
 //---------------------------------------------------------------------------
 namespace data_structures::tagged_hash_table {
@@ -66,11 +73,95 @@ class HashTable {
         private:
         Entry* current;
     };
+    /// Library-managed storage for entries, placed according to a NUMA policy.
+    /// When partitioned, each node allocates from its own local partition and
+    /// falls back to the other partitions once it is full.
+    class EntryStorage {
+        public:
+        /// Constructor. Reserves room for at least the given number of entries.
+        explicit EntryStorage(uint64_t capacity, numa::Policy policy = numa::Policy::NONE,
+                              uint32_t partitions = numa::node_count())
+            : memory(reserved_bytes(capacity, policy, partitions), policy, partitions),
+              cursors(memory.partitions()) {
+            for(uint32_t p = 0; p < memory.partitions(); ++p) {
+                auto [begin, end] = memory.partition(p);
+                cursors[p].begin = (begin + sizeof(Entry) - 1) / sizeof(Entry);
+                cursors[p].next = cursors[p].begin;
+                // Keep every entry within the pages of its partition
+                cursors[p].end = std::max(cursors[p].begin, end / sizeof(Entry));
+            }
+        }
+        /// Destructor
+        ~EntryStorage() {
+            if constexpr(!std::is_trivially_destructible_v<Entry>) {
+                for(auto& cursor : cursors) {
+                    for(uint64_t i = cursor.begin; i < std::min<uint64_t>(cursor.next, cursor.end); ++i)
+                        entries()[i].~Entry();
+                }
+            }
+        }
+        /// Create an entry in the partition local to the given node, or in a
+        /// remote one if the local partition is full. Workers pass the node
+        /// they are bound to. Thread-safe.
+        Entry* emplace(uint64_t key, ValueT value, uint32_t node) {
+            uint32_t local = memory.partition_for_node(node);
+            for(uint32_t i = 0; i < cursors.size(); ++i) {
+                auto& cursor = cursors[(local + i) % cursors.size()];
+                if(cursor.next.load() >= cursor.end)
+                    continue;
+                uint64_t slot = cursor.next.fetch_add(1);
+                if(slot < cursor.end)
+                    return new (&entries()[slot]) Entry(key, value);
+            }
+            throw std::bad_alloc();
+        }
+        /// Get the number of partitions.
+        uint32_t partitions() const { return cursors.size(); }
+        /// Get the slot range [begin, end) of a partition.
+        std::pair<uint64_t, uint64_t> partition(uint32_t p) const { return {cursors[p].begin, cursors[p].end}; }
+        /// Get the capacity of the storage.
+        uint64_t capacity() const {
+            uint64_t result = 0;
+            for(auto& cursor : cursors)
+                result += cursor.end - cursor.begin;
+            return result;
+        }
+        /// Report the nodes the entries live on.
+        std::vector<numa::Region> placement() const { return memory.placement(); }
+
+        private:
+        /// The bump allocator of a partition
+        struct Cursor {
+            /// The first slot of the partition
+            uint64_t begin = 0;
+            /// The next free slot
+            std::atomic<uint64_t> next = 0;
+            /// The end of the partition
+            uint64_t end = 0;
+        };
+        /// Get the bytes to reserve for the given number of entries. Entries
+        /// crossing a partition boundary are skipped, so there is one spare
+        /// entry per boundary.
+        static uint64_t reserved_bytes(uint64_t capacity, numa::Policy policy, uint32_t partitions) {
+            if(policy == numa::Policy::PARTITION && partitions > 1)
+                capacity += partitions - 1;
+            return capacity * sizeof(Entry);
+        }
+        /// Get the entry slots.
+        Entry* entries() const { return reinterpret_cast<Entry*>(memory.data()); }
+        /// The memory backing the entries
+        numa::Buffer memory;
+        /// One bump allocator per partition
+        std::vector<Cursor> cursors;
+    };
     /// Constructor 
-    explicit HashTable(uint64_t size) {
-        uint64_t ht_size = next_power_of_2(size);
+    explicit HashTable(uint64_t size, numa::Policy policy = numa::Policy::NONE,
+                       uint32_t partitions = numa::node_count()) {
+        ht_size = next_power_of_2(size);
         ht_mask = ht_size - 1;
-        table = std::vector<std::atomic<Entry*>>(ht_size);
+        memory = numa::Buffer(ht_size * sizeof(std::atomic<Entry*>), policy, partitions);
+        table = reinterpret_cast<std::atomic<Entry*>*>(memory.data());
+        std::uninitialized_value_construct_n(table, ht_size);
     }
     /// Insert an entry into the hash table.
     void insert(Entry* entry) {
@@ -101,7 +192,21 @@ class HashTable {
         return BucketIterator(untag(table[bucket]));
     }
     /// Get the size of the hash table.
-    size_t size() const { return table.size(); }
+    size_t size() const { return ht_size; }
+    /// Get the directory partition owning the slot of a key.
+    uint32_t home_partition(uint64_t key) const {
+        uint64_t slot = mm_hash(key) & ht_mask;
+        return memory.partition_of(slot * sizeof(std::atomic<Entry*>));
+    }
+    /// Get the node owning the slot of a key. When partitioned, workers bound
+    /// to this node probe the slot locally.
+    uint32_t home_node(uint64_t key) const { return memory.node_of_partition(home_partition(key)); }
+    /// Get the number of directory partitions.
+    uint32_t partitions() const { return memory.partitions(); }
+    /// Get the placement policy of the hash table.
+    numa::Policy policy() const { return memory.policy(); }
+    /// Report the nodes the hash table lives on.
+    std::vector<numa::Region> placement() const { return memory.placement(); }
     /// Get the end of the hash table.
     BucketIterator end() { return BucketIterator(); }
 
@@ -120,8 +225,12 @@ class HashTable {
     uint64_t tag_mask = 0xFFFF000000000000;
     /// The mask for efficient modulo
     uint64_t ht_mask;
+    /// The number of slots
+    uint64_t ht_size;
+    /// The memory backing the hash table
+    numa::Buffer memory;
     /// The hash table interface
-    std::vector<std::atomic<Entry*>> table;
+    std::atomic<Entry*>* table;
 };
 //---------------------------------------------------------------------------
 }
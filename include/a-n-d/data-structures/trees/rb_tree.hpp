@@ -1,6 +1,11 @@
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
+#include <iostream>
+#include <new>
 #include <span>
+#include <string>
+#include <type_traits>
 #include <vector>
 //---------------------------------------------------------------------------
 using std::byte;
@@ -23,15 +28,205 @@ template <typename KeyT, typename ValueT> struct RedBlackNode {
   RedBlackNode(KeyT key, ValueT value) : key(key), value(value) {}
 };
 //---------------------------------------------------------------------------
-template <typename KeyT, typename ValueT> class RedBlackTree {
+/// A compact node addressed by 32-bit indices into the tree's buffer. Index 0
+/// denotes null, the color is packed into the top bit of the parent index.
+template <typename KeyT> struct CompactLinks {
+  static constexpr uint32_t kColorBit = 1u << 31;
+  //---------------------------------------------------------------------------
+  uint32_t children[2] = {0, 0};
+  uint32_t parent_color = 0;
+  KeyT key;
+  //---------------------------------------------------------------------------
+  explicit CompactLinks(KeyT k) : key(k) {}
+};
+template <typename KeyT, typename ValueT>
+struct CompactNode : CompactLinks<KeyT> {
+  ValueT value;
+  //---------------------------------------------------------------------------
+  CompactNode(KeyT k, ValueT v) : CompactLinks<KeyT>(k), value(v) {}
+};
+//---------------------------------------------------------------------------
+/// A reference to the key and value of a compact node.
+template <typename KeyT, typename ValueT> class NodeRef {
+public:
+  struct Entry {
+    const KeyT &key;
+    ValueT &value;
+  };
+  //---------------------------------------------------------------------------
+  /// Proxy keeping the entry alive for the duration of a member access.
+  class Arrow {
+  public:
+    explicit Arrow(Entry e) : entry(e) {}
+    Entry *operator->() { return &entry; }
+
+  private:
+    Entry entry;
+  };
+  //---------------------------------------------------------------------------
+  NodeRef(std::nullptr_t = nullptr) {}
+  NodeRef(const KeyT *key, ValueT *value) : key_ptr(key), value_ptr(value) {}
+  //---------------------------------------------------------------------------
+  Arrow operator->() const { return Arrow({*key_ptr, *value_ptr}); }
+  bool operator==(std::nullptr_t) const { return key_ptr == nullptr; }
+  bool operator==(const NodeRef &other) const = default;
+
+private:
+  const KeyT *key_ptr = nullptr;
+  ValueT *value_ptr = nullptr;
+};
+//---------------------------------------------------------------------------
+/// Layout policy storing full pointers and a color byte in every node.
+struct PointerLayout {
+  template <typename KeyT, typename ValueT> class Nodes {
+  public:
+    using Node = RedBlackNode<KeyT, ValueT>;
+    using Id = Node *;
+    using Ref = Node *;
+    static constexpr Id kNull = nullptr;
+    static constexpr uint64_t kNodeSize = sizeof(Node);
+    //---------------------------------------------------------------------------
+    explicit Nodes(span<byte> buffer_) : buffer(buffer_) {}
+    //---------------------------------------------------------------------------
+    Id allocate(KeyT key, ValueT value) {
+      uint64_t offset = count * kNodeSize;
+      //---------------------------------------------------------------------------
+      if (offset + kNodeSize > buffer.size())
+        throw std::bad_alloc();
+      void *node_ptr = buffer.data() + offset;
+      //---------------------------------------------------------------------------
+      ++count;
+      return new (node_ptr) Node(key, value);
+    }
+    //---------------------------------------------------------------------------
+    uint64_t size() const { return count; }
+    Ref ref(Id node) const { return node; }
+    const KeyT &key(Id node) const { return node->key; }
+    Id child(Id node, uint8_t dir) const { return node->children[dir]; }
+    void setChild(Id node, uint8_t dir, Id child) {
+      node->children[dir] = child;
+    }
+    Id parent(Id node) const { return node->parent; }
+    void setParent(Id node, Id parent) { node->parent = parent; }
+    Color color(Id node) const { return node->color; }
+    void setColor(Id node, Color color) { node->color = color; }
+
+  private:
+    span<byte> buffer;
+    uint64_t count = 0;
+  };
+};
+//---------------------------------------------------------------------------
+/// Layout policy for small fixed-width keys and values. Nodes are linked by
+/// 32-bit indices and carry their color in a spare bit. With kSplitValues,
+/// the hot part (links and key) grows from the front of the buffer and the
+/// cold values grow from its back, so that searches only touch the keys.
+template <bool kSplitValues = false> struct CompactLayout {
+  template <typename KeyT, typename ValueT> class Nodes {
+    static_assert(std::is_trivially_copyable_v<KeyT> &&
+                      std::is_trivially_copyable_v<ValueT>,
+                  "CompactLayout requires fixed-width keys and values.");
+
+  public:
+    using Hot = std::conditional_t<kSplitValues, CompactLinks<KeyT>,
+                                   CompactNode<KeyT, ValueT>>;
+    using Id = uint32_t;
+    using Ref = NodeRef<KeyT, ValueT>;
+    static constexpr Id kNull = 0;
+    static constexpr uint64_t kNodeSize =
+        sizeof(Hot) + (kSplitValues ? sizeof(ValueT) : 0);
+    //---------------------------------------------------------------------------
+    explicit Nodes(span<byte> buffer_) : buffer(buffer_) {}
+    //---------------------------------------------------------------------------
+    Id allocate(KeyT key, ValueT value) {
+      uint64_t hot_end = (count + 1) * sizeof(Hot);
+      uint64_t cold_begin = buffer.size();
+      if constexpr (kSplitValues)
+        cold_begin = coldEnd() - (count + 1) * sizeof(ValueT);
+      //---------------------------------------------------------------------------
+      if (count + 1 >= Hot::kColorBit ||
+          (kSplitValues && (count + 1) * sizeof(ValueT) > coldEnd()) ||
+          hot_end > cold_begin)
+        throw std::bad_alloc();
+      //---------------------------------------------------------------------------
+      Id node = ++count;
+      if constexpr (kSplitValues) {
+        new (&hot(node)) Hot(key);
+        new (&coldValue(node)) ValueT(value);
+      } else {
+        new (&hot(node)) Hot(key, value);
+      }
+      return node;
+    }
+    //---------------------------------------------------------------------------
+    uint64_t size() const { return count; }
+    Ref ref(Id node) const {
+      if (node == kNull)
+        return Ref();
+      return Ref(&hot(node).key, &value(node));
+    }
+    const KeyT &key(Id node) const { return hot(node).key; }
+    Id child(Id node, uint8_t dir) const { return hot(node).children[dir]; }
+    void setChild(Id node, uint8_t dir, Id child) {
+      hot(node).children[dir] = child;
+    }
+    Id parent(Id node) const {
+      return hot(node).parent_color & ~Hot::kColorBit;
+    }
+    void setParent(Id node, Id parent) {
+      auto &parent_color = hot(node).parent_color;
+      parent_color = (parent_color & Hot::kColorBit) | parent;
+    }
+    Color color(Id node) const {
+      return (hot(node).parent_color & Hot::kColorBit) ? Color::BLACK
+                                                       : Color::RED;
+    }
+    void setColor(Id node, Color color) {
+      auto &parent_color = hot(node).parent_color;
+      parent_color = (parent_color & ~Hot::kColorBit) |
+                     (color == Color::BLACK ? Hot::kColorBit : 0);
+    }
+
+  private:
+    Hot &hot(Id node) const {
+      return reinterpret_cast<Hot *>(buffer.data())[node - 1];
+    }
+    ValueT &value(Id node) const {
+      if constexpr (kSplitValues)
+        return coldValue(node);
+      else
+        return hot(node).value;
+    }
+    /// The aligned end of the cold region, counted from the buffer start.
+    uint64_t coldEnd() const {
+      auto end = reinterpret_cast<uintptr_t>(buffer.data() + buffer.size());
+      return end / alignof(ValueT) * alignof(ValueT) -
+             reinterpret_cast<uintptr_t>(buffer.data());
+    }
+    ValueT &coldValue(Id node) const {
+      return reinterpret_cast<ValueT *>(buffer.data() + coldEnd())[-int64_t(node)];
+    }
+    //---------------------------------------------------------------------------
+    span<byte> buffer;
+    uint64_t count = 0;
+  };
+};
+//---------------------------------------------------------------------------
+template <typename KeyT, typename ValueT, typename Layout = PointerLayout>
+class RedBlackTree {
+  using Nodes = typename Layout::template Nodes<KeyT, ValueT>;
+  using Id = typename Nodes::Id;
+  static constexpr Id kNull = Nodes::kNull;
+
 public:
-  static const uint64_t kNodeAlignment = sizeof(RedBlackNode<KeyT, ValueT>);
+  using Ref = typename Nodes::Ref;
+  static constexpr uint64_t kNodeAlignment = Nodes::kNodeSize;
   //---------------------------------------------------------------------------
   /// Default Constructor.
   RedBlackTree() = delete;
   //---------------------------------------------------------------------------
   /// Constructor. Places the RedBlackTree at given location.
-  explicit RedBlackTree(span<byte> buffer) : buffer(buffer) {}
+  explicit RedBlackTree(span<byte> buffer) : nodes(buffer) {}
   //---------------------------------------------------------------------------
   /// Destructor.
   ~RedBlackTree() = default;
@@ -39,51 +234,51 @@ public:
   /// @brief Inserts a node into the tree.
   /// @param key The key to be inserted.
   /// @param value The value to be inserted.
-  /// @returns A pointer to the inserted node.
-  RedBlackNode<KeyT, ValueT> *insert(KeyT key, ValueT value) {
-    RedBlackNode<KeyT, ValueT> *node = allocateNode(key, value);
+  /// @returns A reference to the inserted node.
+  Ref insert(KeyT key, ValueT value) {
+    Id node = nodes.allocate(key, value);
     //---------------------------------------------------------------------------
-    if (size == 1) {
+    if (nodes.size() == 1) {
       root = node;
     } else {
       bool left = false;
       auto parent = findParent(key, left);
-      assert(parent != nullptr);
+      assert(parent != kNull);
       //---------------------------------------------------------------------------
-      node->parent = parent;
-      parent->children[static_cast<uint32_t>(left)] = node;
+      nodes.setParent(node, parent);
+      nodes.setChild(parent, static_cast<uint8_t>(left), node);
       //---------------------------------------------------------------------------
-      if (parent->color == Color::RED) {
+      if (nodes.color(parent) == Color::RED) {
         rotate(node);
       }
     }
     //---------------------------------------------------------------------------
-    return node;
+    return nodes.ref(node);
   }
   //---------------------------------------------------------------------------
   /// @brief Finds a node in the tree, if it exists.
   /// @param key The key to be looked up.
-  /// @returns A pointer to the found node.
-  RedBlackNode<KeyT, ValueT> *lookup(KeyT key) const {
-    vector<RedBlackNode<KeyT, ValueT> *> stack;
+  /// @returns A reference to the found node.
+  Ref lookup(KeyT key) const {
+    vector<Id> stack;
     stack.push_back(root);
     //---------------------------------------------------------------------------
     while (stack.size() > 0) {
       auto cur = stack.back();
       stack.pop_back();
-      if (cur->key == key) {
-        return cur;
+      if (nodes.key(cur) == key) {
+        return nodes.ref(cur);
       }
-      if (cur->key < key) {
-        if (cur->children[1] != nullptr)
-          stack.push_back(cur->children[1]);
+      if (nodes.key(cur) < key) {
+        if (nodes.child(cur, 1) != kNull)
+          stack.push_back(nodes.child(cur, 1));
       } else {
-        if (cur->children[0] != nullptr)
-          stack.push_back(cur->children[0]);
+        if (nodes.child(cur, 0) != kNull)
+          stack.push_back(nodes.child(cur, 0));
       }
     }
     //---------------------------------------------------------------------------
-    return nullptr;
+    return nodes.ref(kNull);
   }
   //---------------------------------------------------------------------------
   /// @brief Prints a visual representation of the tree into the console.
@@ -95,8 +290,14 @@ public:
   /// 3. A red node does not have a red child.
   /// 4. Every path from a given node to any of its leaf nodes goes through the
   /// same number of black nodes.
+  /// Additionally, every child links back to its parent.
   bool validate() {
-    vector<pair<RedBlackNode<KeyT, ValueT> *, int>> stack;
+    if (root != kNull && nodes.parent(root) != kNull) {
+      std::cout << "Root has a parent." << std::endl;
+      return false;
+    }
+    //---------------------------------------------------------------------------
+    vector<pair<Id, int>> stack;
     stack.push_back({root, 1});
     //---------------------------------------------------------------------------
     // The number of black nodes on a path.
@@ -107,7 +308,7 @@ public:
       auto cur = top.first;
       int cur_black_depth = top.second;
       stack.pop_back();
-      if (cur == nullptr) {
+      if (cur == kNull) {
         // Rule 4.
         if (black_depth == 0)
           black_depth = cur_black_depth;
@@ -119,48 +320,57 @@ public:
         }
         continue;
       }
-      if (cur->color != Color::RED && cur->color != Color::BLACK) {
-        std::cout << "Color of node with key: \"" << cur->key
+      if (nodes.color(cur) != Color::RED && nodes.color(cur) != Color::BLACK) {
+        std::cout << "Color of node with key: \"" << nodes.key(cur)
                   << "\" is neither black nor red." << std::endl;
         this->print();
         return false; // Rule 1.
       }
-      if (cur->color == Color::RED &&
-          ((cur->children[0] && cur->children[0]->color == Color::RED) ||
-           (cur->children[1] && cur->children[1]->color == Color::RED))) {
-        std::cout << "Color of red node with key: \"" << cur->key
+      auto left = nodes.child(cur, 0);
+      auto right = nodes.child(cur, 1);
+      if ((left != kNull && nodes.parent(left) != cur) ||
+          (right != kNull && nodes.parent(right) != cur)) {
+        std::cout << "Child of node with key: \"" << nodes.key(cur)
+                  << "\" does not link back to it." << std::endl;
+        this->print();
+        return false;
+      }
+      if (nodes.color(cur) == Color::RED &&
+          ((left != kNull && nodes.color(left) == Color::RED) ||
+           (right != kNull && nodes.color(right) == Color::RED))) {
+        std::cout << "Color of red node with key: \"" << nodes.key(cur)
                   << "\" has at least one red child." << std::endl;
         this->print();
         return false; // Rule 3.
       }
       auto new_black_depth =
-          cur_black_depth + (cur->color == Color::BLACK ? 1 : 0);
-      stack.push_back({cur->children[0], new_black_depth});
-      stack.push_back({cur->children[1], new_black_depth});
+          cur_black_depth + (nodes.color(cur) == Color::BLACK ? 1 : 0);
+      stack.push_back({left, new_black_depth});
+      stack.push_back({right, new_black_depth});
     }
     //---------------------------------------------------------------------------
     return true;
   }
 
 private:
-  RedBlackNode<KeyT, ValueT> *findParent(KeyT key, bool &left) const {
-    assert(root != nullptr);
+  Id findParent(KeyT key, bool &left) const {
+    assert(root != kNull);
     //---------------------------------------------------------------------------
-    RedBlackNode<KeyT, ValueT> *pred = nullptr;
-    vector<RedBlackNode<KeyT, ValueT> *> stack;
+    Id pred = kNull;
+    vector<Id> stack;
     stack.push_back(root);
     //---------------------------------------------------------------------------
     while (stack.size() > 0) {
       auto cur = stack.back();
       stack.pop_back();
-      if (cur->key <= key) {
-        if (cur->children[1] != nullptr)
-          stack.push_back(cur->children[1]);
+      if (nodes.key(cur) <= key) {
+        if (nodes.child(cur, 1) != kNull)
+          stack.push_back(nodes.child(cur, 1));
         else
           left = true;
       } else {
-        if (cur->children[0] != nullptr)
-          stack.push_back(cur->children[0]);
+        if (nodes.child(cur, 0) != kNull)
+          stack.push_back(nodes.child(cur, 0));
         else
           left = false;
       }
@@ -170,38 +380,38 @@ private:
     return pred;
   }
   //---------------------------------------------------------------------------
-  void rotate(RedBlackNode<KeyT, ValueT> *cur) {
-    while (cur != nullptr) {
+  void rotate(Id cur) {
+    while (cur != kNull) {
       //---------------------------------------------------------------------------
-      if (cur == root || cur->color == Color::BLACK)
+      if (cur == root || nodes.color(cur) == Color::BLACK)
         return;
       //---------------------------------------------------------------------------
-      assert(cur->parent != nullptr);
-      auto parent = cur->parent;
+      assert(nodes.parent(cur) != kNull);
+      auto parent = nodes.parent(cur);
       if (parent == root) {
-        root->color = Color::BLACK;
+        nodes.setColor(root, Color::BLACK);
         return;
       }
       //---------------------------------------------------------------------------
-      assert(cur->parent->parent != nullptr);
-      auto grandparent = parent->parent;
-      if (parent->color == Color::RED) {
+      assert(nodes.parent(parent) != kNull);
+      auto grandparent = nodes.parent(parent);
+      if (nodes.color(parent) == Color::RED) {
         auto dir = static_cast<uint8_t>(getDir(parent));
-        auto aunt = grandparent->children[1 - dir];
-        if (aunt != nullptr && aunt->color == Color::RED) { // Case 2
-          parent->color = Color::BLACK;
-          aunt->color = Color::BLACK;
-          grandparent->color = Color::RED;
+        auto aunt = nodes.child(grandparent, 1 - dir);
+        if (aunt != kNull && nodes.color(aunt) == Color::RED) { // Case 2
+          nodes.setColor(parent, Color::BLACK);
+          nodes.setColor(aunt, Color::BLACK);
+          nodes.setColor(grandparent, Color::RED);
         } else {
-          if (cur == parent->children[1 - dir]) { // Case 5
+          if (cur == nodes.child(parent, 1 - dir)) { // Case 5
             // Rotate
-            parent->children[1 - dir] = cur->children[dir];
-            if (parent->children[1 - dir])
-              parent->children[1 - dir]->parent = parent;
-            cur->children[dir] = parent;
-            cur->parent = grandparent;
-            parent->parent = cur;
-            grandparent->children[dir] = cur;
+            nodes.setChild(parent, 1 - dir, nodes.child(cur, dir));
+            if (nodes.child(parent, 1 - dir) != kNull)
+              nodes.setParent(nodes.child(parent, 1 - dir), parent);
+            nodes.setChild(cur, dir, parent);
+            nodes.setParent(cur, grandparent);
+            nodes.setParent(parent, cur);
+            nodes.setChild(grandparent, dir, cur);
             // Reassign
             auto temp = cur;
             cur = parent;
@@ -209,55 +419,44 @@ private:
           }
           // Case 6
           // Rotate
-          grandparent->children[dir] = parent->children[1 - dir];
-          if (grandparent->children[dir])
-            grandparent->children[dir]->parent = grandparent;
-          parent->children[1 - dir] = grandparent;
-          parent->parent = grandparent->parent;
-          if (parent->parent != nullptr) {
+          nodes.setChild(grandparent, dir, nodes.child(parent, 1 - dir));
+          if (nodes.child(grandparent, dir) != kNull)
+            nodes.setParent(nodes.child(grandparent, dir), grandparent);
+          nodes.setChild(parent, 1 - dir, grandparent);
+          nodes.setParent(parent, nodes.parent(grandparent));
+          if (nodes.parent(parent) != kNull) {
             // Make grandgrandparent aware of changes
-            grandparent->parent
-                ->children[static_cast<uint8_t>(getDir(grandparent))] = parent;
+            nodes.setChild(nodes.parent(grandparent),
+                           static_cast<uint8_t>(getDir(grandparent)), parent);
           }
-          grandparent->parent = parent;
-          if (root->parent != nullptr)
-            root = root->parent;
+          nodes.setParent(grandparent, parent);
+          if (nodes.parent(root) != kNull)
+            root = nodes.parent(root);
           // Color
-          parent->color = Color::BLACK;
-          grandparent->color = Color::RED;
+          nodes.setColor(parent, Color::BLACK);
+          nodes.setColor(grandparent, Color::RED);
         }
       }
       //---------------------------------------------------------------------------
-      cur = cur->parent->parent;
+      cur = nodes.parent(nodes.parent(cur));
     }
   }
   //---------------------------------------------------------------------------q
-  Direction getDir(RedBlackNode<KeyT, ValueT> *node) const {
-    assert(node != nullptr);
+  Direction getDir(Id node) const {
+    assert(node != kNull);
     //---------------------------------------------------------------------------
-    if (node->parent == nullptr || node->parent->children[0] == node)
+    if (nodes.parent(node) == kNull ||
+        nodes.child(nodes.parent(node), 0) == node)
       return Direction::LEFT;
     return Direction::RIGHT;
   }
   //---------------------------------------------------------------------------
-  RedBlackNode<KeyT, ValueT> *allocateNode(KeyT key, ValueT value) {
-    uint64_t offset = size * kNodeAlignment;
-    //---------------------------------------------------------------------------
-    if (offset + kNodeAlignment > buffer.size())
-      throw std::bad_alloc();
-    void *node_ptr = buffer.data() + offset;
-    //---------------------------------------------------------------------------
-    ++size;
-    return new (node_ptr) RedBlackNode<KeyT, ValueT>(key, value);
-  }
-  //---------------------------------------------------------------------------
-  void print(const RedBlackNode<KeyT, ValueT> *node,
-             const std::string &prefix = "", bool isLeft = true) {
-    if (node == nullptr)
+  void print(Id node, const std::string &prefix = "", bool isLeft = true) {
+    if (node == kNull)
       return;
     //---------------------------------------------------------------------------
     std::cout << prefix << std::endl;
-    if (node->parent == nullptr) {
+    if (nodes.parent(node) == kNull) {
       std::cout << "Root: ";
     } else {
       std::cout << prefix;
@@ -266,17 +465,16 @@ private:
       else
         std::cout << "└── R: ";
     }
-    std::cout << "Key: " << node->key
-              << " Color: " << (node->color == Color::RED ? "RED" : "BLACK")
+    std::cout << "Key: " << nodes.key(node) << " Color: "
+              << (nodes.color(node) == Color::RED ? "RED" : "BLACK")
               << std::endl;
     //---------------------------------------------------------------------------
-    print(node->children[0], prefix + (isLeft ? "│   " : "    "), true);
-    print(node->children[1], prefix + (isLeft ? "│   " : "    "), false);
+    print(nodes.child(node, 0), prefix + (isLeft ? "│   " : "    "), true);
+    print(nodes.child(node, 1), prefix + (isLeft ? "│   " : "    "), false);
   }
 
-  span<byte> buffer;
-  RedBlackNode<KeyT, ValueT> *root = nullptr;
-  uint64_t size = 0;
+  Nodes nodes;
+  Id root = kNull;
 };
 //---------------------------------------------------------------------------
-} // namespace data_structures::rb_tree
\ No newline at end of file
+} // namespace data_structures::rb_tree
@@ -5,11 +5,14 @@
 //---------------------------------------------------------------------------
 #include <gtest/gtest.h>
 #include <thread>
+#include <algorithm>
+#include "hashing/numa.h"
 #include "hashing/tagged_hash_table.h"
 #include "hashing/utils.h"
 #include <iostream>
 //---------------------------------------------------------------------------
 using namespace data_structures::tagged_hash_table;
+namespace numa = data_structures::numa;
 //---------------------------------------------------------------------------
 TEST(HashTableTest, Size) {
     uint64_t size = 133;
@@ -91,4 +94,142 @@ TEST(MTHashTableTest, InsertMany) {
         }
         EXPECT_NE(it, ht.end());
     }
-}
\ No newline at end of file
+}
+//---------------------------------------------------------------------------
+TEST(NumaHashTableTest, Placement) {
+    for(auto policy : {numa::Policy::NONE, numa::Policy::INTERLEAVE, numa::Policy::PARTITION}) {
+        auto ht = HashTable<int>(1ull << 16, policy);
+        EXPECT_EQ(ht.policy(), policy);
+        size_t bytes = 0;
+        for(auto& region : ht.placement()) {
+            // The directory is touched on construction
+            if(numa::placement_supported()) {
+                EXPECT_NE(std::find(numa::nodes().begin(), numa::nodes().end(), region.node), numa::nodes().end());
+            } else {
+                EXPECT_EQ(region.node, -1);
+            }
+            bytes += region.size;
+        }
+        EXPECT_EQ(bytes, ht.size() * sizeof(std::atomic<HashTable<int>::Entry*>));
+    }
+}
+//---------------------------------------------------------------------------
+TEST(NumaHashTableTest, PartitionedInsertMany) {
+    size_t size = 1000;
+    uint32_t partitions = 4;
+    auto storage = HashTable<int>::EntryStorage(size, numa::Policy::PARTITION, partitions);
+    auto ht = HashTable<int>(size * 16, numa::Policy::PARTITION, partitions);
+    EXPECT_EQ(ht.partitions(), partitions);
+
+    // Each worker builds the keys homed on its partition
+    std::vector<std::thread> threads;
+    for(uint32_t p = 0; p < partitions; ++p) {
+        threads.emplace_back([&storage, &ht, size, p]() {
+            auto node = numa::nodes()[p % numa::node_count()];
+            numa::bind_thread_to_node(node);
+            for(size_t i = 0; i < size; ++i) {
+                if(ht.home_partition(i) == p)
+                    ht.insert(storage.emplace(i, i*2, node));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // Lookup
+    for(size_t i = 0; i < size; ++i) {
+        auto it = ht.lookup(i);
+        for(; it != ht.end(); ++it) {
+            if(it->key == i) {
+                EXPECT_EQ(it->value, i*2);
+                break;
+            }
+        }
+        EXPECT_NE(it, ht.end());
+    }
+}
+//---------------------------------------------------------------------------
+TEST(NumaHashTableTest, BufferPartitions) {
+    size_t size = 10 * numa::page_size() + 123;
+    for(uint32_t partitions : {1, 3, 4, 11, 64}) {
+        auto buffer = numa::Buffer(size, numa::Policy::PARTITION, partitions);
+        EXPECT_EQ(buffer.partitions(), std::min<uint32_t>(partitions, 11));
+        EXPECT_EQ(buffer.partition(0).first, 0);
+        EXPECT_EQ(buffer.partition(buffer.partitions() - 1).second, size);
+        for(uint32_t p = 0; p < buffer.partitions(); ++p) {
+            auto [begin, end] = buffer.partition(p);
+            EXPECT_LT(begin, end);
+            EXPECT_EQ(begin % numa::page_size(), 0);
+            EXPECT_EQ(buffer.partition_of(begin), p);
+            EXPECT_EQ(buffer.partition_of(end - 1), p);
+            if(p + 1 < buffer.partitions()) {
+                EXPECT_EQ(end, buffer.partition(p + 1).first);
+            }
+        }
+    }
+}
+//---------------------------------------------------------------------------
+TEST(NumaHashTableTest, EntryStorageSlotRanges) {
+    uint64_t size = 10000;
+    for(uint32_t partitions : {1, 3, 4}) {
+        auto storage = HashTable<int>::EntryStorage(size, numa::Policy::PARTITION, partitions);
+        EXPECT_EQ(storage.partitions(), partitions);
+        EXPECT_GE(storage.capacity(), size);
+        uint64_t covered = 0;
+        for(uint32_t p = 0; p < storage.partitions(); ++p) {
+            auto [begin, end] = storage.partition(p);
+            EXPECT_LE(begin, end);
+            if(p + 1 < storage.partitions()) {
+                // No entry crosses into the first page of the next partition
+                auto next = storage.partition(p + 1).first * sizeof(HashTable<int>::Entry);
+                EXPECT_LE(end * sizeof(HashTable<int>::Entry), next / numa::page_size() * numa::page_size());
+            }
+            covered += end - begin;
+        }
+        EXPECT_EQ(covered, storage.capacity());
+    }
+}
+//---------------------------------------------------------------------------
+TEST(NumaHashTableTest, EntryStorageExactCapacity) {
+    uint64_t size = 10000;
+    auto storage = HashTable<int>::EntryStorage(size, numa::Policy::PARTITION, 3);
+
+    // All entries are requested from one node and spill into the others
+    for(uint64_t i = 0; i < size; ++i) {
+        auto entry = storage.emplace(i, i*2, numa::nodes().front());
+        EXPECT_EQ(entry->key, i);
+    }
+    for(uint64_t i = size; i < storage.capacity(); ++i)
+        storage.emplace(i, i*2, numa::nodes().back());
+    EXPECT_THROW(storage.emplace(0, 0, numa::nodes().front()), std::bad_alloc);
+}
+//---------------------------------------------------------------------------
+TEST(NumaHashTableTest, CurrentNode) {
+    auto node = numa::current_node();
+    EXPECT_NE(std::find(numa::nodes().begin(), numa::nodes().end(), node), numa::nodes().end());
+}
+//---------------------------------------------------------------------------
+TEST(NumaHashTableTest, UntouchedPlacement) {
+    if(!numa::placement_supported())
+        GTEST_SKIP() << "Page placement cannot be queried on this host";
+    auto storage = HashTable<int>::EntryStorage(10000, numa::Policy::INTERLEAVE);
+    auto regions = storage.placement();
+    ASSERT_EQ(regions.size(), 1);
+    EXPECT_EQ(regions[0].node, -1);
+
+    storage.emplace(1, 2, numa::current_node());
+    regions = storage.placement();
+    ASSERT_EQ(regions.size(), 2);
+    EXPECT_GE(regions[0].node, 0);
+    EXPECT_EQ(regions[1].node, -1);
+}
+//---------------------------------------------------------------------------
+TEST(NumaHashTableTest, EntryStorageCapacity) {
+    auto storage = HashTable<int>::EntryStorage(1, numa::Policy::INTERLEAVE);
+    EXPECT_EQ(storage.capacity(), 1);
+    auto entry = storage.emplace(1, 5, numa::current_node());
+    EXPECT_EQ(entry->key, 1);
+    EXPECT_EQ(entry->value, 5);
+    EXPECT_THROW(storage.emplace(2, 6, numa::current_node()), std::bad_alloc);
+}
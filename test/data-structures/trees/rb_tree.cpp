@@ -93,12 +93,63 @@ TEST(RBTree, DuplicateInsert10) {
   }
 }
 //---------------------------------------------------------------------------
-TEST(RBTree, RandomInsertBig) {
+TEST(RBTree, CompactNodeSize) {
+  using PointerTree = RedBlackTree<u32, u32>;
+  using CompactTree = RedBlackTree<u32, u32, CompactLayout<>>;
+  using SplitTree = RedBlackTree<u32, u32, CompactLayout<true>>;
+  ASSERT_LE(CompactTree::kNodeAlignment * 2, PointerTree::kNodeAlignment);
+  ASSERT_LE(SplitTree::kNodeAlignment * 2, PointerTree::kNodeAlignment);
+}
+//---------------------------------------------------------------------------
+TEST(RBTree, CompactColorBit) {
+  auto buffer = make_unique<byte[]>(1024);
+  CompactLayout<>::Nodes<u32, u32> nodes(span<byte>(buffer.get(), 1024));
+  auto node = nodes.allocate(1, 2);
+  ASSERT_EQ(nodes.color(node), Color::RED);
+  ASSERT_EQ(nodes.parent(node), 0);
+  //---------------------------------------------------------------------------
+  const u32 max_parent = (1u << 31) - 1;
+  nodes.setColor(node, Color::BLACK);
+  nodes.setParent(node, max_parent);
+  ASSERT_EQ(nodes.color(node), Color::BLACK);
+  ASSERT_EQ(nodes.parent(node), max_parent);
+  nodes.setColor(node, Color::RED);
+  ASSERT_EQ(nodes.parent(node), max_parent);
+  nodes.setParent(node, 0);
+  ASSERT_EQ(nodes.color(node), Color::RED);
+}
+//---------------------------------------------------------------------------
+template <typename Layout> class RBTreeLayout : public testing::Test {};
+using Layouts =
+    testing::Types<PointerLayout, CompactLayout<>, CompactLayout<true>>;
+TYPED_TEST_SUITE(RBTreeLayout, Layouts);
+//---------------------------------------------------------------------------
+TYPED_TEST(RBTreeLayout, ConsecutiveInsertRotations) {
+  const u32 cinsert = 1ull << 10;
+  //---------------------------------------------------------------------------
+  auto buffer = make_unique<byte[]>(1ull << 20);
+  RedBlackTree<u32, u32, TypeParam> rb(span<byte>(buffer.get(), 1ull << 20));
+  //---------------------------------------------------------------------------
+  // Ascending and descending keys force rotations in both directions, which
+  // relink parents and recolor nodes. validate() checks every parent link.
+  for (u32 i = 0; i < cinsert; ++i) {
+    ASSERT_NE(rb.insert(cinsert + i, i), nullptr);
+    ASSERT_NE(rb.insert(cinsert - i, i), nullptr);
+    ASSERT_TRUE(rb.validate());
+  }
+  for (u32 i = 0; i < cinsert; ++i) {
+    auto found = rb.lookup(cinsert + i);
+    ASSERT_NE(found, nullptr);
+    ASSERT_EQ(found->value, i);
+  }
+}
+//---------------------------------------------------------------------------
+TYPED_TEST(RBTreeLayout, RandomInsertBig) {
   const u32 cinsert = 1ull << 12;
   const u32 seed = 12345;
   //---------------------------------------------------------------------------
   auto buffer = make_unique<byte[]>(1ull << 20);
-  RedBlackTree<u32, u32> rb(span<byte>(buffer.get(), 1ull << 20));
+  RedBlackTree<u32, u32, TypeParam> rb(span<byte>(buffer.get(), 1ull << 20));
   //---------------------------------------------------------------------------
   std::vector<u32> keys(cinsert);
   std::iota(keys.begin(), keys.end(), 0);
@@ -109,6 +160,7 @@ TEST(RBTree, RandomInsertBig) {
     u32 key = keys[i];
     auto node = rb.insert(key, key * 42);
     ASSERT_NE(node, nullptr);
+    ASSERT_EQ(node->key, key);
     ASSERT_TRUE(rb.validate());
   }
   for (u32 i = 0; i < cinsert; ++i) {
@@ -117,4 +169,15 @@ TEST(RBTree, RandomInsertBig) {
     ASSERT_NE(found, nullptr);
     ASSERT_EQ(found->value, key * 42);
   }
-}
\ No newline at end of file
+  ASSERT_EQ(rb.lookup(cinsert), nullptr);
+}
+//---------------------------------------------------------------------------
+TEST(RBTree, CompactBufferFull) {
+  auto buffer = make_unique<byte[]>(64);
+  RedBlackTree<u32, u32, CompactLayout<true>> rb(span<byte>(buffer.get(), 64));
+  for (u32 i = 0; i < 64 / decltype(rb)::kNodeAlignment; ++i) {
+    rb.insert(i, i * 42);
+  }
+  ASSERT_THROW(rb.insert(64, 0), std::bad_alloc);
+  ASSERT_TRUE(rb.validate());
+}